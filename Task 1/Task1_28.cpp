@@ -1,23 +1,117 @@
 #include <string>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
 #include <utility>
 #include <list>
 #include <vector>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <fstream>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+#include <chrono>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
 
 class Variable;
 class VariableValue;
+class Cube;
 class And;
 class Or;
 class Not;
 class IfThen;
 class Iff;
 
+// counters and timers around the hot paths, compile with -DNO_STATS to take them out
+class Stats {
+public:
+    enum Counter {
+        ROWS_ENUMERATED,
+        ROW_ALLOCATIONS,
+        INTERSECTION_BYTES,
+        VARIABLE_EVALUATIONS,
+        AND_EVALUATIONS,
+        OR_EVALUATIONS,
+        NOT_EVALUATIONS,
+        IF_THEN_EVALUATIONS,
+        IFF_EVALUATIONS,
+        COUNTER_COUNT
+    };
+
+    enum Phase {
+        ENUMERATE,
+        EVALUATE,
+        INTERSECT,
+        COMPARE,
+        PHASE_COUNT
+    };
+
+    static unsigned long long counters[COUNTER_COUNT];
+    static double seconds[PHASE_COUNT];
+
+    // adds the time spent in its scope to a phase, the enclosing timer is paused meanwhile
+    // so phase times never overlap
+    class Timer {
+    private:
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+        Timer * outer;
+
+        static Timer *& current() {
+            static Timer * timer = nullptr;
+            return timer;
+        }
+
+    public:
+        explicit Timer(Phase phase): phase(phase), start(std::chrono::steady_clock::now()), outer(current()) {
+            if (outer) {
+                seconds[outer->phase] += std::chrono::duration<double>(start - outer->start).count();
+            }
+            current() = this;
+        }
+
+        ~Timer() {
+            auto now = std::chrono::steady_clock::now();
+            seconds[phase] += std::chrono::duration<double>(now - start).count();
+
+            if (outer) {
+                outer->start = now;
+            }
+            current() = outer;
+        }
+    };
+
+    // print all counters and phase times, as text or as JSON
+    static void report(std::ostream& out, bool json);
+};
+
+unsigned long long Stats::counters[Stats::COUNTER_COUNT] = {};
+double Stats::seconds[Stats::PHASE_COUNT] = {};
+
+#ifndef NO_STATS
+#define STATS_ADD(counter, n) (Stats::counters[Stats::counter] += (n))
+#define STATS_TIMER(phase) Stats::Timer stats_timer(Stats::phase)
+#else
+#define STATS_ADD(counter, n) ((void) 0)
+#define STATS_TIMER(phase) ((void) 0)
+#endif
+
 class Expression {
 public:
     // evaluate expression
     virtual bool evaluate() = 0;
 
+    // add the variables this expression depends on to the list, skipping ones already seen
+    virtual void collect_variables(std::vector<Variable*>& used, std::unordered_set<Variable*>& seen) = 0;
+
+    // keep only the variables (in the given order) that at least one of the expressions depends on
+    static std::vector<Variable*> cone_of_influence(std::vector<Variable*>& variables, std::vector<Expression*>& expressions);
+
     // get all binary combinations for a set of variables
     static std::vector<std::vector<VariableValue>> all_ordered_combinations(std::vector<Variable*>& variables);
 
@@ -27,10 +121,23 @@ public:
     // get truth set of an expression
     std::vector<std::vector<VariableValue>> truth_set(std::vector<Variable*>& variables);
 
+    // get truth set of all expressions and-ed together, every row if there are none
+    static std::vector<std::vector<VariableValue>> truth_set_conjunction(std::vector<Variable*>& variables, std::vector<Expression*>& expressions);
+
     // compare two expressions, return collisions
     template<typename... Variables>
     static std::vector<std::vector<VariableValue>> compare(Expression *a, Expression *b, Variable *first, Variables *... rest);
 
+    // get truth set of an expression as cubes, one cube can stand for many rows
+    std::vector<Cube> truth_cubes(std::vector<Variable*>& variables);
+
+    // compare two expressions, return collisions as cubes
+    template<typename... Variables>
+    static std::vector<Cube> compare_cubes(Expression *a, Expression *b, Variable *first, Variables *... rest);
+
+    // enumerate all rows and cover the ones where the condition holds with disjoint cubes
+    static std::vector<Cube> cover(std::vector<Variable*>& variables, const std::function<bool()>& condition);
+
     // operator overloading for all logical operations, easier front-end use experince
     friend And operator&(Expression& c1, Expression& c2);
     friend And operator&(Expression&& c1, Expression& c2);
@@ -51,6 +158,10 @@ public:
 //    friend Iff operator<=>(Expression& e1, Expression&& e2);
 //    friend Iff operator<=>(Expression&& e1, Expression& e2);
 //    friend Iff operator<=>(Expression& e1, Expression& e2);
+
+private:
+    // cubes over variables[i..] as '0'/'1'/'-' patterns, variables before i are already set
+    static std::vector<std::string> cover_patterns(std::vector<Variable*>& variables, const std::function<bool()>& condition, int i);
 };
 
 class Argument {
@@ -68,6 +179,10 @@ public:
     template<typename... Rest>
     static bool satisfiable(std::vector<Variable *> variables, Expression& first, Rest&& ... rest);
     static bool satisfiable(std::vector<Variable *> variables, Expression * first, std::vector<Expression*> rest);
+
+private:
+    // group expressions that (through other expressions) share variables, each group can be solved on its own
+    static std::vector<std::vector<Expression*>> components(std::vector<Variable *>& variables, std::vector<Expression*> expressions);
 };
 
 // variables that have exact values, can be updated
@@ -86,13 +201,24 @@ public:
     explicit Variable(std::string&& name): name(name), value(false) {
     }
 
+    const std::string& get_name() const {
+        return name;
+    }
+
     void set_value(bool v) {
         this->value = v;
     }
 
     bool evaluate() override {
+        STATS_ADD(VARIABLE_EVALUATIONS, 1);
         return value;
     }
+
+    void collect_variables(std::vector<Variable*>& used, std::unordered_set<Variable*>& seen) override {
+        if (seen.insert(this).second) {
+            used.push_back(this);
+        }
+    }
 };
 
 class UnaryExpression : public Expression {
@@ -105,6 +231,10 @@ public:
 
     explicit UnaryExpression(Expression&& a): a(&a) {
     }
+
+    void collect_variables(std::vector<Variable*>& used, std::unordered_set<Variable*>& seen) override {
+        a->collect_variables(used, seen);
+    }
 };
 
 class BinaryExpression : public Expression {
@@ -124,6 +254,11 @@ public:
 
     BinaryExpression(Expression& a, Expression&& b): a(&a), b(&b) {
     }
+
+    void collect_variables(std::vector<Variable*>& used, std::unordered_set<Variable*>& seen) override {
+        a->collect_variables(used, seen);
+        b->collect_variables(used, seen);
+    }
 };
 
 class And : public BinaryExpression {
@@ -131,6 +266,7 @@ public:
     using BinaryExpression::BinaryExpression;
 
     bool evaluate() override {
+        STATS_ADD(AND_EVALUATIONS, 1);
         return a->evaluate() && b->evaluate();
     };
 };
@@ -140,6 +276,7 @@ public:
     using BinaryExpression::BinaryExpression;
 
     bool evaluate() override {
+        STATS_ADD(OR_EVALUATIONS, 1);
         return a->evaluate() || b->evaluate();
     };
 };
@@ -149,6 +286,7 @@ public:
     using BinaryExpression::BinaryExpression;
 
     bool evaluate() override {
+        STATS_ADD(IF_THEN_EVALUATIONS, 1);
         return !a->evaluate() || b->evaluate();
     };
 };
@@ -158,7 +296,8 @@ public:
     using BinaryExpression::BinaryExpression;
 
     bool evaluate() override {
-        return (!a->evaluate() && !b->evaluate()) || (a->evaluate() && b->evaluate());
+        STATS_ADD(IFF_EVALUATIONS, 1);
+        return a->evaluate() == b->evaluate();
     };
 };
 
@@ -167,6 +306,7 @@ public:
     using UnaryExpression::UnaryExpression;
 
     bool evaluate() override {
+        STATS_ADD(NOT_EVALUATIONS, 1);
         return !a->evaluate();
     };
 };
@@ -185,9 +325,46 @@ public:
     }
 };
 
+// partial assignment, variables missing from it are "don't care" and can take either value
+class Cube {
+public:
+    std::vector<VariableValue> values;
+
+    // check if a full row falls inside the cube
+    bool contains(const std::vector<VariableValue>& row) const {
+        for (const VariableValue& v : values) {
+            for (const VariableValue& r : row) {
+                if (r.a == v.a && r.value != v.value) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // write cubes compactly: count, then per cube a mask of set variables and a mask of their values
+    // throws std::runtime_error for more than 64 variables or a cube variable missing from the list
+    static void write(std::ostream& out, const std::vector<Cube>& cubes, std::vector<Variable*>& variables);
+
+    // read cubes written by write(), using the same variables in the same order, throws std::runtime_error on short or bad input
+    static std::vector<Cube> read(std::istream& in, std::vector<Variable*>& variables);
+};
+
+template<typename... Variables>
+std::vector<Cube> Expression::compare_cubes(Expression * a, Expression * b, Variable *first, Variables *... rest) {
+    std::vector<Variable *> variables = {first, rest...};
+    STATS_TIMER(COMPARE);
+
+    return cover(variables, [a, b]() {
+        return a->evaluate() != b->evaluate();
+    });
+}
+
 template<typename... Variables>
 std::vector<std::vector<VariableValue>> Expression::compare(Expression * a, Expression * b, Variable *first, Variables *... rest) {
     std::vector<Variable *> variables = {first, rest...};
+    STATS_TIMER(COMPARE);
     std::vector<std::vector<VariableValue>> rows = all_ordered_combinations(variables);
     std::vector<std::vector<VariableValue>> collisions;
 
@@ -241,6 +418,168 @@ Argument::satisfiable(std::vector<Variable *> variables, Expression &first, Rest
     return valid(variables, &first, premises);
 }
 
+// owns expressions loaded from text, the operator overloads leave that to the caller
+//
+// infix syntax uses the overloaded operators with C++ precedence, tightest first:
+//   !a    a >> b    a <=> b    a & b    a | b
+// variable names are identifiers, e.g. "(h | f) & !(h >> b)"
+// brackets, '!' and the resulting expression may nest at most max_depth deep, so parsing and
+// evaluating never run out of stack
+class Formula {
+public:
+    static const int max_depth = 1000;
+
+    // highest variable number a DIMACS file may use
+    static const long max_dimacs_variables = 1L << 22;
+
+    // variables in order of first appearance, DIMACS variables by number
+    std::vector<Variable *> variables;
+
+    Formula() = default;
+
+    // nodes point at each other, a copy would still point into the original
+    Formula(const Formula&) = delete;
+    Formula& operator=(const Formula&) = delete;
+
+    // parse an infix formula, throws std::runtime_error with "line:column" on bad input
+    Expression * parse(const std::string& text);
+
+    // parse a file holding one infix formula
+    Expression * load(const std::string& path);
+
+    // load a DIMACS CNF file as an "and" of "or" clauses
+    Expression * load_dimacs(const std::string& path);
+
+    // find a variable by name, create it if it is new
+    Variable * variable(const std::string& name);
+
+    // drop every node and variable, expressions handed out before become invalid
+    void clear();
+
+private:
+    // nodes live here, deques don't move elements when they grow
+    std::deque<Variable> variable_nodes;
+    std::deque<And> and_nodes;
+    std::deque<Or> or_nodes;
+    std::deque<Not> not_nodes;
+    std::deque<IfThen> if_then_nodes;
+    std::deque<Iff> iff_nodes;
+    std::unordered_map<std::string, Variable *> names;
+
+    // parser state
+    const char * text = nullptr;
+    const char * at = nullptr;
+    std::string name;
+    int nesting = 0;
+
+    // each returns the height of what it parsed, a variable has height 0
+    Expression * parse_or(int& height);
+    Expression * parse_and(int& height);
+    Expression * parse_iff(int& height);
+    Expression * parse_if_then(int& height);
+    Expression * parse_not(int& height);
+    void skip_space();
+    bool accept(const char * op);
+    [[noreturn]] void fail(const char * position, const std::string& message);
+
+    // build a node in one of the deques
+    template<typename T, typename... Args>
+    static T * make(std::deque<T>& nodes, Args&&... args) {
+        nodes.emplace_back(std::forward<Args>(args)...);
+        return &nodes.back();
+    }
+
+    // and/or over a list as a balanced tree, so evaluation depth grows with log of its length
+    template<typename T>
+    Expression * balanced(std::deque<T>& nodes, std::vector<Expression *>& items, size_t begin, size_t end);
+
+    // height of the tree balanced() builds from items with these heights
+    static int balanced_height(std::vector<int>& heights, size_t begin, size_t end);
+
+    // fail at position if an expression got taller than max_depth
+    void check_height(int height, const char * position);
+
+    static std::string read_file(const std::string& path);
+};
+
+// long running query loop, formulas are parsed once and then referred to by handle
+//
+// one request per line, one reply line each:
+//   def <formula>                      -> handle <n>
+//   sat <h> [<h>...]                   -> true | false
+//   valid <conclusion> [<premise>...]  -> true | false
+//   equiv <h> <h>                      -> true | false
+//   compare <h> <h>                    -> collisions [{x=1, y=0} ...]
+//   quit
+// bad requests get "error <message>". queries over more than max_variables variables are refused, and once
+// max_formulas formulas or max_text bytes of formula text are held the session forgets all of them
+// (their handles stop working, new handles keep counting up)
+class Session {
+private:
+    static const int max_variables = 18;
+    static const int max_formulas = 1024;
+    static const int max_text = 1 << 24;
+
+    Formula formula;
+    std::vector<Expression *> handles; // handles[i] is handle first + i
+    std::unordered_map<std::string, long long> known; // formula text -> handle, repeated defs reuse the parsed formula
+    long long first = 0;
+    size_t text_size = 0;
+
+    // read the handles left on a request line
+    std::vector<Expression *> expressions(std::istringstream& request);
+
+public:
+    // answer a single request line
+    std::string handle(const std::string& line);
+
+    // answer requests until "quit" or end of input
+    static void run(std::istream& in, std::ostream& out);
+
+    // feed a session requests it has to refuse without going down, report each on out, true if all passed
+    static bool check(std::ostream& out);
+};
+
+// exhaustive validity check split into shards that separate processes (or machines) can run
+//
+// shard k of n covers its own range of truth table rows, rows are numbered like all_ordered_combinations.
+// a running shard saves <directory>/shard_<k>.progress now and then, so an interrupted shard picks up
+// where it stopped, and writes <directory>/shard_<k>.done when finished. merge() combines the done files.
+// both files carry a fingerprint of the argument, files left behind by a different argument are refused.
+class ShardedArgument {
+public:
+    // more shards than this only adds files, every shard is a process start anyway
+    static const uint64_t max_shards = 1 << 20;
+
+    // run one shard to the end, does nothing if it is already done.
+    // source is the text the argument was parsed from, it goes into the fingerprint
+    static void run(std::vector<Variable *> variables, Expression * conclusion, std::vector<Expression *> premises,
+                    const std::string& source, const std::string& directory, uint64_t shard, uint64_t shards);
+
+    // combine all finished shards into a report, shards that are not done yet are listed as missing.
+    // valid is only true when the done shards together cover every row of the truth table
+    static void merge(const std::string& directory, uint64_t shards, std::ostream& out);
+
+private:
+    // what a shard has found so far
+    class State {
+    public:
+        uint64_t variables = 0;
+        uint64_t shards = 0;
+        uint64_t begin = 0;
+        uint64_t next = 0;
+        uint64_t models = 0;
+        int64_t counterexample = -1;
+        std::string assignment = "-";
+        std::string fingerprint = "-";
+
+        bool read(const std::string& path);
+        void write(const std::string& path) const;
+    };
+
+    static std::string path(const std::string& directory, uint64_t shard, const char * kind);
+};
+
 class TruthRow {
 public:
     static double value(std::vector<VariableValue> values) {
@@ -336,26 +675,39 @@ IfThen operator>>(Expression& e1, Expression& e2) {
 //}
 
 std::vector<std::vector<VariableValue>> Expression::all_ordered_combinations(std::vector<Variable *>& variables) {
+    STATS_TIMER(ENUMERATE);
     std::vector<std::vector<VariableValue>> rows;
+    size_t count = (size_t) pow(2, (double) variables.size());
+
+    // sized up front, one allocation for the table and one per row
+    rows.reserve(count);
+    STATS_ADD(ROW_ALLOCATIONS, 1);
 
     // For all possible rows in truth table
-    for (int i = 0; i < pow(2, (double) variables.size()); ++i) {
+    for (int i = 0; i < count; ++i) {
         std::vector<VariableValue> row;
 
+        if (!variables.empty()) {
+            row.reserve(variables.size());
+            STATS_ADD(ROW_ALLOCATIONS, 1);
+        }
+
         // Set up each variable
         for (int j = 0; j < variables.size(); ++j) {
             row.emplace_back(variables[j], (i >> j) & 1);
         }
 
-        rows.emplace_back(row);
+        rows.emplace_back(std::move(row));
     }
 
+    STATS_ADD(ROWS_ENUMERATED, rows.size());
     return rows;
 }
 
 std::vector<std::vector<VariableValue>> Expression::truth_set(std::vector<Variable *>& variables) {
     std::vector<std::vector<VariableValue>> rows = all_ordered_combinations(variables);
     std::vector<std::vector<VariableValue>> set;
+    STATS_TIMER(EVALUATE);
 
     for (std::vector<VariableValue>& row : rows) {
         for (VariableValue& v : row) {
@@ -370,11 +722,188 @@ std::vector<std::vector<VariableValue>> Expression::truth_set(std::vector<Variab
     return set;
 }
 
+std::vector<std::string> Expression::cover_patterns(std::vector<Variable *>& variables, const std::function<bool()>& condition, int i) {
+    if (i == variables.size()) {
+        STATS_ADD(ROWS_ENUMERATED, 1);
+
+        if (condition()) {
+            return {""};
+        }
+        return {};
+    }
+
+    variables[i]->set_value(false);
+    std::vector<std::string> off = cover_patterns(variables, condition, i + 1);
+    variables[i]->set_value(true);
+    std::vector<std::string> on = cover_patterns(variables, condition, i + 1);
+
+    std::sort(off.begin(), off.end());
+    std::sort(on.begin(), on.end());
+
+    // a cube found for both values of this variable doesn't care about it
+    std::vector<std::string> patterns;
+    int j = 0, k = 0;
+
+    while (j < off.size() || k < on.size()) {
+        if (j < off.size() && k < on.size() && off[j] == on[k]) {
+            patterns.emplace_back("-" + off[j]);
+            j++; k++;
+        }
+        else
+        if (k == on.size() || (j < off.size() && off[j] < on[k]))
+            patterns.emplace_back("0" + off[j++]);
+        else
+            patterns.emplace_back("1" + on[k++]);
+    }
+
+    return patterns;
+}
+
+std::vector<Cube> Expression::cover(std::vector<Variable *>& variables, const std::function<bool()>& condition) {
+    std::vector<Cube> cubes;
+
+    for (const std::string& pattern : cover_patterns(variables, condition, 0)) {
+        Cube cube;
+
+        for (int j = 0; j < variables.size(); ++j) {
+            if (pattern[j] != '-') {
+                cube.values.emplace_back(variables[j], pattern[j] == '1');
+            }
+        }
+
+        cubes.emplace_back(cube);
+    }
+
+    return cubes;
+}
+
+std::vector<Cube> Expression::truth_cubes(std::vector<Variable *>& variables) {
+    STATS_TIMER(EVALUATE);
+
+    return cover(variables, [this]() {
+        return this->evaluate();
+    });
+}
+
+void Cube::write(std::ostream& out, const std::vector<Cube>& cubes, std::vector<Variable *>& variables) {
+    auto put = [&out](uint64_t x) {
+        for (int i = 0; i < 8; ++i) {
+            out.put((char) ((x >> (8 * i)) & 0xff));
+        }
+    };
+
+    if (variables.size() > 64) {
+        throw std::runtime_error("cubes can only be written for up to 64 variables");
+    }
+
+    put(cubes.size());
+
+    for (const Cube& cube : cubes) {
+        uint64_t set = 0, values = 0;
+
+        for (const VariableValue& v : cube.values) {
+            size_t index = std::find(variables.begin(), variables.end(), v.a) - variables.begin();
+
+            if (index == variables.size()) {
+                throw std::runtime_error("cube uses a variable that is not in the list");
+            }
+
+            uint64_t bit = (uint64_t) 1 << index;
+            set |= bit;
+            if (v.value) values |= bit;
+        }
+
+        put(set);
+        put(values);
+    }
+}
+
+std::vector<Cube> Cube::read(std::istream& in, std::vector<Variable *>& variables) {
+    auto get = [&in]() {
+        uint64_t x = 0;
+        for (int i = 0; i < 8; ++i) {
+            int byte = in.get();
+            if (byte == EOF) {
+                throw std::runtime_error("cubes end early");
+            }
+            x |= (uint64_t) byte << (8 * i);
+        }
+        return x;
+    };
+
+    if (variables.size() > 64) {
+        throw std::runtime_error("cubes can only be read for up to 64 variables");
+    }
+
+    // grow as cubes arrive, a broken count must not turn into one huge allocation
+    uint64_t count = get();
+    uint64_t unused = variables.size() == 64 ? 0 : ~(uint64_t) 0 << variables.size();
+    std::vector<Cube> cubes;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t set = get(), values = get();
+        cubes.emplace_back();
+        Cube& cube = cubes.back();
+
+        if ((set & unused) != 0) {
+            throw std::runtime_error("cube uses a variable that is not in the list");
+        }
+
+        for (int j = 0; j < variables.size(); ++j) {
+            if ((set >> j) & 1) {
+                cube.values.emplace_back(variables[j], (values >> j) & 1);
+            }
+        }
+    }
+
+    return cubes;
+}
+
+std::vector<std::vector<VariableValue>> Expression::truth_set_conjunction(std::vector<Variable *>& variables, std::vector<Expression *>& expressions) {
+    if (expressions.empty()) {
+        return all_ordered_combinations(variables);
+    }
+
+    auto set = expressions[0]->truth_set(variables);
+
+    for (int i = 1; i < expressions.size() && !set.empty(); ++i) {
+        set = truth_set_intersection(set, expressions[i]->truth_set(variables));
+    }
+
+    return set;
+}
+
+std::vector<Variable *> Expression::cone_of_influence(std::vector<Variable *>& variables, std::vector<Expression *>& expressions) {
+    std::vector<Variable *> used;
+    std::unordered_set<Variable *> seen;
+    std::vector<Variable *> cone;
+
+    for (Expression * e : expressions) {
+        e->collect_variables(used, seen);
+    }
+
+    // every variable left out halves the truth table
+    for (Variable * v : variables) {
+        if (seen.count(v)) {
+            cone.push_back(v);
+        }
+    }
+
+    return cone;
+}
+
 std::vector<std::vector<VariableValue>>
 Expression::truth_set_intersection(std::vector<std::vector<VariableValue>> a, std::vector<std::vector<VariableValue>> b) {
+    STATS_TIMER(INTERSECT);
     std::vector<std::vector<VariableValue>> set;
     int i = 0, j = 0;
 
+#ifndef NO_STATS
+    // both truth sets arrive as copies
+    for (std::vector<VariableValue>& row : a) STATS_ADD(INTERSECTION_BYTES, row.size() * sizeof(VariableValue));
+    for (std::vector<VariableValue>& row : b) STATS_ADD(INTERSECTION_BYTES, row.size() * sizeof(VariableValue));
+#endif
+
     while (i < a.size() && j < b.size()) {
         if (TruthRow::value(a[i]) == TruthRow::value(b[j])) {
             set.emplace_back(a[i]);
@@ -390,30 +919,976 @@ Expression::truth_set_intersection(std::vector<std::vector<VariableValue>> a, st
     return set;
 }
 
+std::vector<std::vector<Expression *>> Argument::components(std::vector<Variable *>& variables, std::vector<Expression *> expressions) {
+    std::vector<int> parent(expressions.size());
+    std::vector<int> owner(variables.size(), -1); // first expression using each variable
+    std::unordered_map<Variable *, int> position;
+
+    for (int j = 0; j < variables.size(); ++j) {
+        position.emplace(variables[j], j);
+    }
+
+    for (int i = 0; i < expressions.size(); ++i) {
+        parent[i] = i;
+    }
+
+    auto find = [&parent](int i) {
+        while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+
+    for (int i = 0; i < expressions.size(); ++i) {
+        std::vector<Variable *> used;
+        std::unordered_set<Variable *> seen;
+        expressions[i]->collect_variables(used, seen);
+
+        for (Variable * v : used) {
+            auto found = position.find(v);
+            if (found == position.end()) continue;
+
+            int j = found->second;
+
+            if (owner[j] == -1)
+                owner[j] = i;
+            else
+                parent[find(i)] = find(owner[j]);
+        }
+    }
+
+    // groups come out in order of their first expression, expressions keep their order inside a group
+    std::vector<std::vector<Expression *>> groups;
+    std::vector<int> group_of(expressions.size(), -1);
+
+    for (int i = 0; i < expressions.size(); ++i) {
+        int root = find(i);
+
+        if (group_of[root] == -1) {
+            group_of[root] = groups.size();
+            groups.emplace_back();
+        }
+
+        groups[group_of[root]].push_back(expressions[i]);
+    }
+
+    return groups;
+}
+
 bool Argument::valid(std::vector<Variable *> variables, Expression *conclusion, std::vector<Expression *> premises) {
-    auto conclusion_ts = conclusion->truth_set(variables);
-    auto premises_ts = premises[0]->truth_set(variables);
+    std::vector<Expression *> expressions = {conclusion};
+    expressions.insert(expressions.end(), premises.begin(), premises.end());
 
-    for (int i = 1; i < premises.size(); ++i) {
-        premises_ts = Expression::truth_set_intersection(premises_ts, premises[i]->truth_set(variables));
+    auto groups = components(variables, expressions);
+
+    // premises sharing nothing with the conclusion only matter if they contradict each other
+    for (int i = 1; i < groups.size(); ++i) {
+        auto cone = Expression::cone_of_influence(variables, groups[i]);
+
+        if (Expression::truth_set_conjunction(cone, groups[i]).empty()) {
+            return true;
+        }
     }
 
+    auto cone = Expression::cone_of_influence(variables, groups[0]);
+    std::vector<Expression *> related(groups[0].begin() + 1, groups[0].end());
+
+    auto conclusion_ts = conclusion->truth_set(cone);
+    auto premises_ts = Expression::truth_set_conjunction(cone, related);
+
     // compare and make sure
     return premises_ts.size() == Expression::truth_set_intersection(conclusion_ts, premises_ts).size();
 }
 
 bool Argument::satisfiable(std::vector<Variable *> variables, Expression *first, std::vector<Expression *> rest) {
-    auto first_ts = first->truth_set(variables);
-    auto rest_ts = rest[0]->truth_set(variables);
+    std::vector<Expression *> expressions = {first};
+    expressions.insert(expressions.end(), rest.begin(), rest.end());
+
+    // independent groups are satisfiable together exactly when each one is satisfiable alone
+    for (std::vector<Expression *>& group : components(variables, expressions)) {
+        auto cone = Expression::cone_of_influence(variables, group);
+
+        if (Expression::truth_set_conjunction(cone, group).empty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Variable * Formula::variable(const std::string& name) {
+    auto found = names.find(name);
+
+    if (found != names.end()) {
+        return found->second;
+    }
+
+    Variable * v = make(variable_nodes, std::string(name), false);
+    names.emplace(name, v);
+    variables.push_back(v);
+
+    return v;
+}
+
+void Formula::clear() {
+    variables.clear();
+    variable_nodes.clear();
+    and_nodes.clear();
+    or_nodes.clear();
+    not_nodes.clear();
+    if_then_nodes.clear();
+    iff_nodes.clear();
+    names.clear();
+}
+
+std::string Formula::read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+    if (!file) {
+        throw std::runtime_error(path + ": cannot open file");
+    }
+
+    // read everything in one go, tokens are then just pointers into this buffer
+    std::string content(file.tellg(), '\0');
+    file.seekg(0);
+    file.read(&content[0], content.size());
+
+    return content;
+}
+
+void Formula::fail(const char * position, const std::string& message) {
+    int line = 1, column = 1;
+
+    for (const char * c = text; c < position; ++c) {
+        if (*c == '\n') {
+            line++;
+            column = 1;
+        }
+        else {
+            column++;
+        }
+    }
+
+    throw std::runtime_error(std::to_string(line) + ":" + std::to_string(column) + ": " + message);
+}
 
-    for (int i = 1; i < rest.size(); ++i) {
-        rest_ts = Expression::truth_set_intersection(rest_ts, rest[i]->truth_set(variables));
+void Formula::skip_space() {
+    while (isspace((unsigned char) *at)) {
+        at++;
     }
+}
+
+bool Formula::accept(const char * op) {
+    skip_space();
+
+    size_t length = strlen(op);
 
-    return !Expression::truth_set_intersection(first_ts, rest_ts).empty();
+    if (strncmp(at, op, length) != 0) {
+        return false;
+    }
+
+    at += length;
+    return true;
+}
+
+template<typename T>
+Expression * Formula::balanced(std::deque<T>& nodes, std::vector<Expression *>& items, size_t begin, size_t end) {
+    if (end - begin == 1) {
+        return items[begin];
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    Expression * a = balanced(nodes, items, begin, middle);
+    Expression * b = balanced(nodes, items, middle, end);
+
+    return make(nodes, *a, *b);
+}
+
+int Formula::balanced_height(std::vector<int>& heights, size_t begin, size_t end) {
+    if (end - begin == 1) {
+        return heights[begin];
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    return 1 + std::max(balanced_height(heights, begin, middle), balanced_height(heights, middle, end));
+}
+
+void Formula::check_height(int height, const char * position) {
+    if (height > max_depth) {
+        fail(position, "formula nested deeper than " + std::to_string(max_depth));
+    }
+}
+
+Expression * Formula::parse(const std::string& source) {
+    text = at = source.c_str();
+    nesting = 0;
+
+    int height;
+    Expression * root = parse_or(height);
+
+    skip_space();
+    if (*at != '\0') {
+        fail(at, std::string("unexpected '") + *at + "'");
+    }
+
+    return root;
+}
+
+Expression * Formula::load(const std::string& path) {
+    std::string source = read_file(path);
+
+    try {
+        return parse(source);
+    }
+    catch (std::runtime_error& e) {
+        throw std::runtime_error(path + ":" + e.what());
+    }
+}
+
+Expression * Formula::parse_or(int& height) {
+    std::vector<Expression *> items;
+    std::vector<int> heights;
+
+    do {
+        items.push_back(parse_and(height));
+        heights.push_back(height);
+    } while (accept("|"));
+
+    height = balanced_height(heights, 0, heights.size());
+    check_height(height, at);
+
+    return balanced(or_nodes, items, 0, items.size());
+}
+
+Expression * Formula::parse_and(int& height) {
+    std::vector<Expression *> items;
+    std::vector<int> heights;
+
+    do {
+        items.push_back(parse_iff(height));
+        heights.push_back(height);
+    } while (accept("&"));
+
+    height = balanced_height(heights, 0, heights.size());
+    check_height(height, at);
+
+    return balanced(and_nodes, items, 0, items.size());
+}
+
+Expression * Formula::parse_iff(int& height) {
+    std::vector<Expression *> items;
+    std::vector<int> heights;
+
+    // "<=>" is associative, so it can be balanced like "&" and "|"
+    do {
+        items.push_back(parse_if_then(height));
+        heights.push_back(height);
+    } while (accept("<=>"));
+
+    height = balanced_height(heights, 0, heights.size());
+    check_height(height, at);
+
+    return balanced(iff_nodes, items, 0, items.size());
+}
+
+Expression * Formula::parse_if_then(int& height) {
+    Expression * e = parse_not(height);
+
+    // left to right like the C++ operator, it isn't associative so the chain stays left-deep
+    while (accept(">>")) {
+        const char * op = at - 2;
+        int b_height;
+        Expression * b = parse_not(b_height);
+
+        height = 1 + std::max(height, b_height);
+        check_height(height, op);
+        e = make(if_then_nodes, *e, *b);
+    }
+
+    return e;
+}
+
+Expression * Formula::parse_not(int& height) {
+    if (accept("!") || accept("(")) {
+        const char * op = at - 1;
+
+        if (++nesting > max_depth) {
+            fail(op, "formula nested deeper than " + std::to_string(max_depth));
+        }
+
+        Expression * e;
+
+        if (*op == '!') {
+            e = make(not_nodes, *parse_not(height));
+            height++;
+            check_height(height, op);
+        }
+        else {
+            e = parse_or(height);
+
+            if (!accept(")")) {
+                fail(op, "unclosed '('");
+            }
+        }
+
+        nesting--;
+        return e;
+    }
+
+    skip_space();
+
+    if (!isalpha((unsigned char) *at) && *at != '_') {
+        fail(at, *at == '\0' ? "unexpected end of formula" : std::string("unexpected '") + *at + "'");
+    }
+
+    const char * start = at;
+    while (isalnum((unsigned char) *at) || *at == '_') {
+        at++;
+    }
+
+    name.assign(start, at);
+    height = 0;
+    return variable(name);
+}
+
+Expression * Formula::load_dimacs(const std::string& path) {
+    std::string source = read_file(path);
+    std::vector<Expression *> clauses;
+    std::vector<Expression *> literals;
+    std::vector<Variable *> numbered;
+    long declared = -1; // variable count from the header, if there is one
+
+    text = at = source.c_str();
+
+    try {
+        while (true) {
+            skip_space();
+
+            if (*at == '\0' || *at == '%') {
+                break;
+            }
+
+            // comment or problem line "p cnf <variables> <clauses>"
+            if (*at == 'c' || *at == 'p') {
+                if (*at == 'p') {
+                    char * after;
+                    const char * header = at;
+
+                    if (strncmp(at, "p cnf", 5) != 0) {
+                        fail(at, "expected \"p cnf\"");
+                    }
+
+                    errno = 0;
+                    long count = strtol(at + 5, &after, 10);
+                    if (after == at + 5 || errno == ERANGE || count < 0 || count > max_dimacs_variables) {
+                        fail(header, "bad variable count, expected 0 to " + std::to_string(max_dimacs_variables));
+                    }
+
+                    const char * counted = after;
+                    long clause_count = strtol(counted, &after, 10);
+                    if (after == counted || errno == ERANGE || clause_count < 0) {
+                        fail(header, "bad clause count");
+                    }
+
+                    for (long i = numbered.size(); i < count; ++i) {
+                        numbered.push_back(variable(std::to_string(i + 1)));
+                    }
+
+                    declared = count;
+                    clauses.reserve(std::min(clause_count, 1L << 24));
+                }
+
+                while (*at != '\0' && *at != '\n') {
+                    at++;
+                }
+                continue;
+            }
+
+            char * after;
+            errno = 0;
+            long literal = strtol(at, &after, 10);
+
+            if (after == at) {
+                fail(at, std::string("unexpected '") + *at + "'");
+            }
+
+            // also keeps -literal below from overflowing
+            if (errno == ERANGE || literal < -max_dimacs_variables || literal > max_dimacs_variables) {
+                fail(at, "variable number out of range, the limit is " + std::to_string(max_dimacs_variables));
+            }
+
+            if (literal == 0) {
+                if (literals.empty()) {
+                    fail(at, "empty clause");
+                }
+
+                clauses.push_back(balanced(or_nodes, literals, 0, literals.size()));
+                literals.clear();
+            }
+            else {
+                long index = literal < 0 ? -literal : literal;
+
+                if (declared >= 0 && index > declared) {
+                    fail(at, "variable " + std::to_string(index) + " is above the declared count " + std::to_string(declared));
+                }
+
+                for (long i = numbered.size(); i < index; ++i) {
+                    numbered.push_back(variable(std::to_string(i + 1)));
+                }
+
+                Expression * v = numbered[index - 1];
+                literals.push_back(literal < 0 ? make(not_nodes, *v) : v);
+            }
+
+            at = after;
+        }
+
+        // last clause may leave out its terminating 0
+        if (!literals.empty()) {
+            clauses.push_back(balanced(or_nodes, literals, 0, literals.size()));
+        }
+
+        if (clauses.empty()) {
+            fail(at, "no clauses");
+        }
+    }
+    catch (std::runtime_error& e) {
+        throw std::runtime_error(path + ":" + e.what());
+    }
+
+    return balanced(and_nodes, clauses, 0, clauses.size());
+}
+
+std::vector<Expression *> Session::expressions(std::istringstream& request) {
+    std::vector<Expression *> list;
+    std::string word;
+
+    while (request >> word) {
+        size_t end = 0;
+        long long h = -1;
+
+        try {
+            h = std::stoll(word, &end);
+        }
+        catch (std::exception&) {
+        }
+
+        if (end != word.size() || h < first || h - first >= (long long) handles.size()) {
+            throw std::runtime_error("unknown handle " + word);
+        }
+
+        list.push_back(handles[h - first]);
+    }
+
+    if (list.empty()) {
+        throw std::runtime_error("missing handle");
+    }
+
+    // the truth tables behind a query double with every variable
+    size_t count = Expression::cone_of_influence(formula.variables, list).size();
+    if (count > max_variables) {
+        throw std::runtime_error("query uses " + std::to_string(count) + " variables, the limit is " + std::to_string(max_variables));
+    }
+
+    return list;
+}
+
+std::string Session::handle(const std::string& line) {
+    std::istringstream request(line);
+    std::string command;
+    request >> command;
+
+    try {
+        if (command == "def") {
+            std::string text;
+            std::getline(request, text);
+
+            auto found = known.find(text);
+            if (found == known.end()) {
+                if (handles.size() >= max_formulas || text_size + text.size() > max_text) {
+                    first += handles.size();
+                    handles.clear();
+                    known.clear();
+                    formula.clear();
+                    text_size = 0;
+                }
+
+                // counted before parsing, failed parses leave nodes behind too
+                text_size += text.size();
+                handles.push_back(formula.parse(text));
+                found = known.emplace(text, first + handles.size() - 1).first;
+            }
+
+            return "handle " + std::to_string(found->second);
+        }
+
+        std::vector<Expression *> list = expressions(request);
+        std::vector<Expression *> rest(list.begin() + 1, list.end());
+
+        if (command == "sat") {
+            return Argument::satisfiable(formula.variables, list[0], rest) ? "true" : "false";
+        }
+
+        if (command == "valid") {
+            return Argument::valid(formula.variables, list[0], rest) ? "true" : "false";
+        }
+
+        if (command == "equiv" || command == "compare") {
+            if (list.size() != 2) {
+                throw std::runtime_error(command + " takes two handles");
+            }
+
+            Expression * a = list[0];
+            Expression * b = list[1];
+            auto cone = Expression::cone_of_influence(formula.variables, list);
+            STATS_TIMER(COMPARE);
+            auto collisions = Expression::cover(cone, [a, b]() {
+                return a->evaluate() != b->evaluate();
+            });
+
+            if (command == "equiv") {
+                return collisions.empty() ? "true" : "false";
+            }
+
+            std::string reply = "collisions";
+            for (Cube& cube : collisions) {
+                reply += " {";
+                for (int i = 0; i < cube.values.size(); ++i) {
+                    reply += (i ? ", " : "") + cube.values[i].a->get_name() + "=" + (cube.values[i].value ? "1" : "0");
+                }
+                reply += "}";
+            }
+
+            return reply;
+        }
+
+        throw std::runtime_error("unknown command " + command);
+    }
+    catch (std::exception& e) {
+        return std::string("error ") + e.what();
+    }
+}
+
+void Session::run(std::istream& in, std::ostream& out) {
+    Session session;
+    std::string line;
+
+    while (std::getline(in, line) && line != "quit") {
+        if (line.empty()) continue;
+
+        out << session.handle(line) << std::endl;
+    }
+}
+
+bool Session::check(std::ostream& out) {
+    Session session;
+    bool passed = true;
+
+    std::string brackets = std::string(200000, '(') + "a" + std::string(200000, ')');
+    std::string chain = "a";
+    std::string wide = "v0";
+
+    for (int i = 0; i < 300000; ++i) {
+        chain += ">>a";
+    }
+    for (int i = 1; i < 100000; ++i) {
+        wide += "|v" + std::to_string(i);
+    }
+
+    auto expect = [&](const std::string& what, const std::string& request, const std::string& reply) {
+        auto start = std::chrono::steady_clock::now();
+        std::string got = session.handle(request);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // a refusal has to come back quickly too
+        bool ok = got.compare(0, reply.size(), reply) == 0 && seconds < 1;
+        passed = passed && ok;
+
+        out << (ok ? "pass " : "FAIL ") << what << ": " << got.substr(0, 80) << " (" << seconds << " s)" << std::endl;
+    };
+
+    expect("deep brackets", "def " + brackets, "error 1:1002: formula nested deeper than 1000");
+    expect("long >> chain", "def " + chain, "error 1:3003: formula nested deeper than 1000");
+    expect("wide formula", "def " + wide, "handle 0");
+    expect("too many variables", "sat 0", "error query uses 100000 variables");
+    expect("still answering", "def a & !b", "handle 1");
+    expect("still answering", "sat 1", "true");
+
+    return passed;
+}
+
+std::string ShardedArgument::path(const std::string& directory, uint64_t shard, const char * kind) {
+    return directory + "/shard_" + std::to_string(shard) + "." + kind;
+}
+
+bool ShardedArgument::State::read(const std::string& path) {
+    std::ifstream in(path);
+    std::string key;
+
+    if (!in) {
+        return false;
+    }
+
+    while (in >> key) {
+        if (key == "variables") in >> variables;
+        else if (key == "shards") in >> shards;
+        else if (key == "begin") in >> begin;
+        else if (key == "next") in >> next;
+        else if (key == "models") in >> models;
+        else if (key == "counterexample") in >> counterexample;
+        else if (key == "assignment") in >> assignment;
+        else if (key == "fingerprint") in >> fingerprint;
+    }
+
+    return true;
+}
+
+void ShardedArgument::State::write(const std::string& path) const {
+    // write next to it and rename, a crash never leaves a half written file behind
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary);
+        out << "variables " << variables << "\n"
+            << "shards " << shards << "\n"
+            << "begin " << begin << "\n"
+            << "next " << next << "\n"
+            << "models " << models << "\n"
+            << "counterexample " << counterexample << "\n"
+            << "assignment " << assignment << "\n"
+            << "fingerprint " << fingerprint << "\n";
+
+        if (!out) {
+            throw std::runtime_error(temporary + ": cannot write file");
+        }
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error(path + ": cannot replace file");
+    }
+}
+
+void ShardedArgument::run(std::vector<Variable *> variables, Expression * conclusion, std::vector<Expression *> premises,
+                          const std::string& source, const std::string& directory, uint64_t shard, uint64_t shards) {
+    std::vector<Expression *> expressions = {conclusion};
+    expressions.insert(expressions.end(), premises.begin(), premises.end());
+
+    auto cone = Expression::cone_of_influence(variables, expressions);
+
+    if (cone.size() > 62) {
+        throw std::runtime_error("too many variables to enumerate");
+    }
+    if (shards == 0 || shards > max_shards || shard >= shards) {
+        throw std::runtime_error("no shard " + std::to_string(shard) + " of " + std::to_string(shards));
+    }
+
+    // spread the rows that don't divide evenly over the first shards
+    uint64_t total = (uint64_t) 1 << cone.size();
+    uint64_t size = total / shards, extra = total % shards;
+    uint64_t begin = shard * size + std::min(shard, extra);
+    uint64_t end = begin + size + (shard < extra ? 1 : 0);
+
+    // FNV-1a over the argument text and the enumerated variables, in order
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const std::string& text) {
+        for (char c : text) {
+            hash = (hash ^ (unsigned char) c) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    };
+
+    mix(source);
+    for (Variable * v : cone) {
+        mix(v->get_name());
+    }
+
+    char fingerprint[17];
+    snprintf(fingerprint, sizeof(fingerprint), "%016llx", (unsigned long long) hash);
+
+    State state;
+
+    if (state.read(path(directory, shard, "done"))) {
+        if (state.fingerprint != fingerprint || state.shards != shards) {
+            throw std::runtime_error(path(directory, shard, "done") + ": written for a different argument or shard count");
+        }
+        return;
+    }
+
+    if (!state.read(path(directory, shard, "progress"))) {
+        state.next = begin;
+    }
+    else if (state.fingerprint != fingerprint || state.variables != cone.size() || state.shards != shards || state.begin != begin) {
+        throw std::runtime_error(path(directory, shard, "progress") + ": saved for a different argument or shard count");
+    }
+
+    state.fingerprint = fingerprint;
+    state.variables = cone.size();
+    state.shards = shards;
+    state.begin = begin;
+
+    STATS_TIMER(EVALUATE);
+
+    for (uint64_t row = state.next; row < end; ++row) {
+        // only set the variables whose bit changed since the last row
+        uint64_t changed = row == state.next ? ~(uint64_t) 0 : row ^ (row - 1);
+
+        for (int j = 0; j < cone.size(); ++j) {
+            if ((changed >> j) & 1) {
+                cone[j]->set_value((row >> j) & 1);
+            }
+        }
+
+        STATS_ADD(ROWS_ENUMERATED, 1);
+
+        bool premises_hold = true;
+        for (Expression * premise : premises) {
+            if (!premise->evaluate()) {
+                premises_hold = false;
+                break;
+            }
+        }
+
+        if (premises_hold) {
+            state.models++;
+
+            if (state.counterexample == -1 && !conclusion->evaluate()) {
+                state.counterexample = row;
+                state.assignment = "";
+
+                for (int j = 0; j < cone.size(); ++j) {
+                    state.assignment += (j ? "," : "") + cone[j]->get_name() + "=" + (((row >> j) & 1) ? "1" : "0");
+                }
+            }
+        }
+
+        if ((row + 1) % (1 << 22) == 0) {
+            state.next = row + 1;
+            state.write(path(directory, shard, "progress"));
+        }
+    }
+
+    state.next = end;
+    state.write(path(directory, shard, "done"));
+    std::remove(path(directory, shard, "progress").c_str());
+}
+
+void ShardedArgument::merge(const std::string& directory, uint64_t shards, std::ostream& out) {
+    uint64_t rows = 0, models = 0, done = 0, variables = 0;
+    int64_t counterexample = -1;
+    std::string assignment = "-";
+    std::string fingerprint;
+    std::string missing;
+
+    if (shards == 0 || shards > max_shards) {
+        throw std::runtime_error("cannot merge " + std::to_string(shards) + " shards");
+    }
+
+    // shards cover increasing rows, so the first counterexample found is the lowest one
+    for (uint64_t shard = 0; shard < shards; ++shard) {
+        State state;
+
+        if (!state.read(path(directory, shard, "done"))) {
+            missing += (missing.empty() ? "" : " ") + std::to_string(shard);
+            continue;
+        }
+
+        if (state.shards != shards) {
+            throw std::runtime_error(path(directory, shard, "done") + ": written for " + std::to_string(state.shards) + " shards");
+        }
+
+        if (state.variables > 62 || state.begin > state.next || state.next - state.begin > (uint64_t) 1 << state.variables) {
+            throw std::runtime_error(path(directory, shard, "done") + ": row range does not fit " + std::to_string(state.variables) + " variables");
+        }
+
+        if (fingerprint.empty()) {
+            fingerprint = state.fingerprint;
+            variables = state.variables;
+        }
+        else if (state.fingerprint != fingerprint || state.variables != variables) {
+            throw std::runtime_error(path(directory, shard, "done") + ": written for a different argument than the other shards");
+        }
+
+        done++;
+        rows += state.next - state.begin;
+        models += state.models;
+
+        if (counterexample == -1 && state.counterexample != -1) {
+            counterexample = state.counterexample;
+            assignment = state.assignment;
+        }
+    }
+
+    // a counterexample settles it, otherwise every shard has to be done and every row counted
+    bool complete = done == shards && rows == (uint64_t) 1 << variables;
+    const char * valid = counterexample != -1 ? "false" : (complete ? "true" : "unknown");
+
+    out << "shards_done " << done << "/" << shards << "\n"
+        << "missing " << (missing.empty() ? "-" : missing) << "\n"
+        << "rows " << rows << "\n"
+        << "models " << models << "\n"
+        << "counterexample " << counterexample << "\n"
+        << "assignment " << assignment << "\n"
+        << "fingerprint " << (fingerprint.empty() ? "-" : fingerprint) << "\n"
+        << "valid " << valid << std::endl;
+}
+
+void Stats::report(std::ostream& out, bool json) {
+    static const char * counter_names[COUNTER_COUNT] = {
+        "rows_enumerated", "row_allocations", "intersection_bytes",
+        "variable_evaluations", "and_evaluations", "or_evaluations",
+        "not_evaluations", "if_then_evaluations", "iff_evaluations"
+    };
+    static const char * phase_names[PHASE_COUNT] = {"enumerate", "evaluate", "intersect", "compare"};
+
+#ifdef NO_STATS
+    out << (json ? "{}" : "built with NO_STATS, nothing was recorded") << std::endl;
+    return;
+#endif
+
+    if (json) {
+        out << "{\"counters\": {";
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            out << (i ? ", " : "") << "\"" << counter_names[i] << "\": " << counters[i];
+        }
+        out << "}, \"seconds\": {";
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            out << (i ? ", " : "") << "\"" << phase_names[i] << "\": " << seconds[i];
+        }
+        out << "}}" << std::endl;
+        return;
+    }
+
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        out << counter_names[i] << ": " << counters[i] << std::endl;
+    }
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        out << phase_names[i] << ": " << seconds[i] << " s" << std::endl;
+    }
 }
 
 int main(int argc, char** argv) {
+    // --stats prints a text report to stderr when the program is done, --stats=json a JSON one
+    std::vector<std::string> args;
+    int stats = 0; // 0 none, 1 text, 2 JSON
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0) stats = 1;
+        else if (strcmp(argv[i], "--stats=json") == 0) stats = 2;
+        else args.push_back(argv[i]);
+    }
+
+    // a shard number or count: digits only, no sign, fits in 64 bits
+    auto number = [](const std::string& text, uint64_t& value) {
+        if (text.empty() || text.size() > 19 || text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        value = std::stoull(text);
+        return true;
+    };
+
+    auto finish = [stats](int status) {
+        if (stats) {
+            Stats::report(std::cerr, stats == 2);
+        }
+        return status;
+    };
+
+    if (!args.empty() && !((args[0] == "--serve" && args.size() == 1) ||
+                           (args[0] == "--check" && args.size() == 1) ||
+                           (args[0] == "--shard" && args.size() == 4) ||
+                           (args[0] == "--merge" && args.size() == 3))) {
+        std::cerr << "usage: " << argv[0] << " [--stats | --stats=json]\n"
+                  << "       " << argv[0] << " --serve [--stats | --stats=json]\n"
+                  << "       " << argv[0] << " --check\n"
+                  << "       " << argv[0] << " --shard <k>/<n> <directory> <file> [--stats | --stats=json]\n"
+                  << "       " << argv[0] << " --merge <n> <directory>" << std::endl;
+        return 2;
+    }
+
+    if (!args.empty() && args[0] == "--serve") {
+        Session::run(std::cin, std::cout);
+        return finish(0);
+    }
+
+    // --check: make sure the session refuses oversized requests instead of crashing or stalling
+    if (!args.empty() && args[0] == "--check") {
+        return finish(Session::check(std::cout) ? 0 : 1);
+    }
+
+    // --shard <k>/<n> <directory> <file>: run shard k of n, the file holds the conclusion on
+    // its first line and one premise per line after it
+    if (!args.empty() && args[0] == "--shard") {
+        uint64_t shard, shards;
+        size_t slash = args[1].find('/');
+        const std::string& path = args[3];
+        std::ifstream file(path);
+        std::string source, line;
+        Formula formula;
+        std::vector<Expression *> expressions;
+
+        if (slash == std::string::npos || !number(args[1].substr(0, slash), shard) ||
+            !number(args[1].substr(slash + 1), shards) || shards == 0 || shards > ShardedArgument::max_shards || shard >= shards) {
+            std::cerr << "expected <k>/<n> with k < n <= " << ShardedArgument::max_shards << ", got " << args[1] << std::endl;
+            return 2;
+        }
+
+        try {
+            if (!file) {
+                throw std::runtime_error(path + ": cannot open file");
+            }
+
+            std::stringstream content;
+            content << file.rdbuf();
+            source = content.str();
+            std::istringstream lines(source);
+
+            for (int number = 1; std::getline(lines, line); ++number) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+                try {
+                    expressions.push_back(formula.parse(line));
+                }
+                catch (std::runtime_error& e) {
+                    // a single line always parses as line 1, swap in the line number in the file
+                    std::string message = e.what();
+                    throw std::runtime_error(path + ":" + std::to_string(number) + message.substr(message.find(':')));
+                }
+            }
+
+            if (expressions.empty()) {
+                throw std::runtime_error(path + ": no conclusion");
+            }
+
+            std::vector<Expression *> premises(expressions.begin() + 1, expressions.end());
+            ShardedArgument::run(formula.variables, expressions[0], premises, source, args[2], shard, shards);
+        }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return finish(1);
+        }
+
+        return finish(0);
+    }
+
+    // --merge <n> <directory>: combine the finished shards
+    if (!args.empty() && args[0] == "--merge") {
+        uint64_t shards;
+
+        if (!number(args[1], shards) || shards == 0 || shards > ShardedArgument::max_shards) {
+            std::cerr << "expected a shard count from 1 to " << ShardedArgument::max_shards << ", got " << args[1] << std::endl;
+            return 2;
+        }
+
+        try {
+            ShardedArgument::merge(args[2], shards, std::cout);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return finish(1);
+        }
+
+        return finish(0);
+    }
+
     Variable
     f("I played football"),
     s("I played basketball"),
@@ -447,5 +1922,5 @@ int main(int argc, char** argv) {
     std::cout << (satisfiable ? "The argument is satisfiable." : "The argument is not satisfiable.") << std::endl;
     std::cout << (valid ? "The argument is valid." : "The argument is falsifiable.") << std::endl;
 
-    return 0;
+    return finish(0);
 }
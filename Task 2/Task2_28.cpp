@@ -8,6 +8,11 @@
 #include <string>
 #include <stack>
 #include <cctype>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <random>
+#include <chrono>
 
 using namespace std;
 
@@ -134,6 +139,137 @@ bool evaluateBooleanExpression(const string &expression) {
     return operands.top() == '1';
 }
 
+// Turn an expression into a postfix program, same precedence handling as evaluateBooleanExpression
+// but operations are written out instead of being applied.
+// Returns an empty program if the expression would run either stack dry (e.g. "&", ")" or "")
+vector<char> compileExpression(const string &expression) {
+    stack<char> operators;
+    vector<char> program;
+    int depth = 0; // operands on the stack when the program runs
+
+    // write out an operation, false if there are not enough operands for it
+    auto emit = [&program, &depth](char operation) {
+        int needed = operation == '!' ? 1 : 2;
+        if (depth < needed) {
+            return false;
+        }
+        depth -= needed - 1;
+        program.push_back(operation);
+        return true;
+    };
+
+    for (char ch : expression) {
+        if (isspace(ch)) continue;
+
+        if (ch == '0' || ch == '1' || ch == 'A' || ch == 'B' || ch == 'C') {
+            program.push_back(ch);
+            depth++;
+        } else if (ch == '(') {
+            operators.push(ch);
+        } else if (ch == ')') {
+
+            while (!operators.empty() && operators.top() != '(') {
+                if (!emit(operators.top())) return {};
+                operators.pop();
+            }
+            if (operators.empty()) return {};
+            operators.pop();
+        } else if (ch == '&' || ch == '|' || ch == '!') {
+
+            while (!operators.empty() && (operators.top() == '!' ||
+                   (operators.top() == '&' && (ch == '&' || ch == '|')) ||
+                   (operators.top() == '|' && ch == '|'))) {
+                if (!emit(operators.top())) return {};
+                operators.pop();
+            }
+            operators.push(ch);
+        }
+    }
+
+    while (!operators.empty()) {
+        if (!emit(operators.top())) return {};
+        operators.pop();
+    }
+
+    if (depth == 0) return {};
+
+    return program;
+}
+
+// Run a compiled program on 64 rows at once, bit i of A, B and C is the input of row i
+uint64_t evaluateCompiled(const vector<char> &program, uint64_t A, uint64_t B, uint64_t C) {
+    // the stack never holds more operands than the program has instructions,
+    // so one buffer grown to the longest program so far serves every call
+    static vector<uint64_t> operands;
+    if (operands.size() < program.size()) {
+        operands.resize(program.size());
+    }
+
+    uint64_t *stack = operands.data();
+    size_t size = 0;
+
+    for (char op : program) {
+        if (op == '0') {
+            stack[size++] = 0;
+        } else if (op == '1') {
+            stack[size++] = ~(uint64_t)0;
+        } else if (op == 'A') {
+            stack[size++] = A;
+        } else if (op == 'B') {
+            stack[size++] = B;
+        } else if (op == 'C') {
+            stack[size++] = C;
+        } else if (op == '!') {
+            stack[size - 1] = ~stack[size - 1];
+        } else {
+            uint64_t operand2 = stack[--size];
+            if (op == '&') {
+                stack[size - 1] &= operand2;
+            } else if (op == '|') {
+                stack[size - 1] |= operand2;
+            } else {
+                // a '(' that was never closed, evaluateOperation gives '0' for it
+                stack[size - 1] = 0;
+            }
+        }
+    }
+
+    return stack[size - 1];
+}
+
+// Compiled programs by expression text, so a circuit is only compiled once
+unordered_map<string, vector<char>> compiledCache;
+
+// The cached program of an expression, compiled on first use. The reference stays valid until
+// the cache is cleared, which the next call may do, so hot loops should copy what they keep
+const vector<char> &compiledProgram(const string &expression) {
+    auto found = compiledCache.find(expression);
+    if (found == compiledCache.end()) {
+        // keep long sessions bounded
+        if (compiledCache.size() >= 4096) {
+            compiledCache.clear();
+        }
+        found = compiledCache.emplace(expression, compileExpression(expression)).first;
+    }
+
+    return found->second;
+}
+
+// Outputs of all 8 rows of truthTable, bit i is the output of row i, -1 if the program is empty (malformed)
+int truthTableBits(const vector<char> &program) {
+    if (program.empty()) {
+        return -1;
+    }
+
+    // column patterns of truthTable, A is the most significant input
+    return (uint8_t)evaluateCompiled(program, 0xF0, 0xCC, 0xAA);
+}
+
+// Same for an expression, through the cache
+int truthTableBits(const string &expression) {
+    return truthTableBits(compiledProgram(expression));
+}
+
 // Print the truth table for both
 void printTruthTable(bool circuitOutput[8], string circuitName) {
     cout << "Truth Table for " << circuitName << ":\n";
@@ -145,26 +281,8 @@ void printTruthTable(bool circuitOutput[8], string circuitName) {
 
 // Check if the expressions are equivalent
 void checkEquivalence(string originalExpr, string simplifiedExpr) {
-    bool A, B, C;
-    bool originalOutput[8], simplifiedOutput[8];
-    bool areEquivalent = true;
-
-    for (int i = 0; i < 8; ++i) {
-        A = truthTable[i][0];
-        B = truthTable[i][1];
-        C = truthTable[i][2];
-        string temp1 = originalExpr, temp2 = simplifiedExpr;
-        substituteVariables(temp1, A, B, C);
-        substituteVariables(temp2, A, B, C);
-
-        originalOutput[i] = evaluateBooleanExpression(temp1);
-        simplifiedOutput[i] = evaluateBooleanExpression(temp2);
-
-        if (originalOutput[i] != simplifiedOutput[i]) {
-            areEquivalent = false;
-            break;
-        }
-    }
+    // all rows at once
+    bool areEquivalent = truthTableBits(originalExpr) == truthTableBits(simplifiedExpr);
 
     if (areEquivalent) {
         cout << "Expressions are equivalent.\n";
@@ -178,31 +296,26 @@ bool checkSatisfiability(string originalExpr, string simplifiedExpr) {
     bool A, B, C;
     bool originalOutput[8], simplifiedOutput[8];
     bool satisfiable = false;
+    int originalBits = truthTableBits(originalExpr);
+    int simplifiedBits = truthTableBits(simplifiedExpr);
+
+    if (originalBits == -1 || simplifiedBits == -1) {
+        cout << "\nInvalid circuit expression, operators are missing operands or brackets don't match.\n";
+        return false;
+    }
 
+    for (int i = 0; i < 8; ++i) {
+        originalOutput[i] = (originalBits >> i) & 1;
+        simplifiedOutput[i] = (simplifiedBits >> i) & 1;
+    }
 
     cout << "\nPrinting truth tables for both expressions:\n";
     // Truth table for the original expression
     cout << "Original Expression:\n";
-    for (int i = 0; i < 8; ++i) {
-        A = truthTable[i][0];
-        B = truthTable[i][1];
-        C = truthTable[i][2];
-        string temp1 = originalExpr;
-        substituteVariables(temp1, A, B, C);
-        originalOutput[i] = evaluateBooleanExpression(temp1);
-    }
     printTruthTable(originalOutput, "Original Expression");
 
     // Truth table for the simplified expression
     cout << "\nSimplified Expression:\n";
-    for (int i = 0; i < 8; ++i) {
-        A = truthTable[i][0];
-        B = truthTable[i][1];
-        C = truthTable[i][2];
-        string temp2 = simplifiedExpr;
-        substituteVariables(temp2, A, B, C);
-        simplifiedOutput[i] = evaluateBooleanExpression(temp2);
-    }
     printTruthTable(simplifiedOutput, "Simplified Expression");
 
     // Check equivalence before satisfiability
@@ -214,11 +327,6 @@ bool checkSatisfiability(string originalExpr, string simplifiedExpr) {
         A = truthTable[i][0];
         B = truthTable[i][1];
         C = truthTable[i][2];
-        string temp1 = originalExpr, temp2 = simplifiedExpr;
-        substituteVariables(temp1, A, B, C);
-        substituteVariables(temp2, A, B, C);
-        originalOutput[i] = evaluateBooleanExpression(temp1);
-        simplifiedOutput[i] = evaluateBooleanExpression(temp2);
 
         // If the outputs from both expressions match, print the values of A, B, C
         if (originalOutput[i] == simplifiedOutput[i]) {
@@ -247,7 +355,207 @@ void modifyGate(string &expression) {
     }
 }
 
-int main() {
+// Random circuit over the first `inputs` of A, B, C, `andPercent` of the gates are '&', the rest '|'
+string randomCircuit(mt19937 &rng, int inputs, int depth, int andPercent) {
+    string circuit;
+    int terms = 1 + rng() % 3;
+
+    for (int t = 0; t < terms; ++t) {
+        if (t > 0) {
+            circuit += (int)(rng() % 100) < andPercent ? '&' : '|';
+        }
+        if (rng() % 3 == 0) {
+            circuit += '!';
+        }
+
+        // chains without brackets exercise the precedence handling, brackets the nesting
+        if (depth > 0 && rng() % 2 == 0) {
+            circuit += "(" + randomCircuit(rng, inputs, depth - 1, andPercent) + ")";
+        } else if (rng() % 10 == 0) {
+            circuit += rng() % 2 ? '1' : '0';
+        } else {
+            circuit += (char)('A' + rng() % inputs);
+        }
+    }
+
+    return circuit;
+}
+
+// Damage a circuit the way user input can be: unclosed or stray brackets, '[' and ']', operands
+// with no operator between them, whitespace and other characters the evaluator skips
+string malformCircuit(mt19937 &rng, string circuit) {
+    const string noise = "(()[] \t.xA1";
+    int edits = 1 + rng() % 3;
+
+    for (int e = 0; e < edits; ++e) {
+        size_t at = rng() % (circuit.size() + 1);
+
+        if (rng() % 4 == 0) {
+            size_t close = circuit.find(')', at);
+            if (close != string::npos) {
+                circuit.erase(close, 1); // leaves a '(' unclosed
+                continue;
+            }
+        }
+        circuit.insert(at, 1, noise[rng() % noise.size()]);
+    }
+
+    return circuit;
+}
+
+// Check the compiled evaluator against the string evaluator on random circuits and time both,
+// results are printed as JSON
+int benchmark() {
+    mt19937 rng(28);
+    int mismatches = 0;
+    bool first = true;
+
+    cout << "[" << endl;
+    for (int inputs = 1; inputs <= 3; ++inputs) {
+        for (int depth = 0; depth <= 6; depth += 2) {
+            for (int andPercent = 20; andPercent <= 80; andPercent += 30) {
+                vector<string> circuits;
+                int malformed = 0;
+                for (int i = 0; i < 200; ++i) {
+                    circuits.push_back(randomCircuit(rng, inputs, depth, andPercent));
+
+                    // a third are damaged, as long as the string evaluator can still run them
+                    // (anything compileExpression refuses would empty one of its stacks)
+                    if (i % 3 == 0) {
+                        string damaged = malformCircuit(rng, circuits.back());
+                        if (!compileExpression(damaged).empty()) {
+                            circuits.back() = damaged;
+                            malformed++;
+                        }
+                    }
+                }
+
+                size_t length = 0;
+                for (const string &circuit : circuits) {
+                    length += circuit.size();
+                }
+
+                // string evaluator, one substitution and parse per row
+                vector<uint8_t> expected(circuits.size(), 0);
+                auto start = chrono::steady_clock::now();
+                for (size_t c = 0; c < circuits.size(); ++c) {
+                    for (int i = 0; i < 8; ++i) {
+                        string temp = circuits[c];
+                        substituteVariables(temp, truthTable[i][0], truthTable[i][1], truthTable[i][2]);
+                        expected[c] |= evaluateBooleanExpression(temp) << i;
+                    }
+                }
+                double stringSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                // compile only
+                vector<vector<char>> programs;
+                start = chrono::steady_clock::now();
+                for (const string &circuit : circuits) {
+                    programs.push_back(compileExpression(circuit));
+                }
+                double compileSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                // compiled evaluator on the programs themselves
+                vector<uint8_t> actual(circuits.size());
+                start = chrono::steady_clock::now();
+                for (size_t c = 0; c < circuits.size(); ++c) {
+                    actual[c] = truthTableBits(programs[c]);
+                }
+                double compiledSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                // compiled evaluator through a warm cache, as serve uses it
+                compiledCache.clear();
+                for (const string &circuit : circuits) {
+                    compiledProgram(circuit);
+                }
+                vector<uint8_t> cached(circuits.size());
+                start = chrono::steady_clock::now();
+                for (size_t c = 0; c < circuits.size(); ++c) {
+                    cached[c] = truthTableBits(circuits[c]);
+                }
+                double cachedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                for (size_t c = 0; c < circuits.size(); ++c) {
+                    if (actual[c] != expected[c] || cached[c] != expected[c]) {
+                        mismatches++;
+                        cerr << "mismatch: " << circuits[c] << "\n";
+                    }
+                }
+
+                // equivalence of neighbouring circuits from a cold cache
+                compiledCache.clear();
+                int equivalent = 0;
+                start = chrono::steady_clock::now();
+                for (size_t c = 0; c + 1 < circuits.size(); ++c) {
+                    equivalent += truthTableBits(circuits[c]) == truthTableBits(circuits[c + 1]);
+                }
+                double equivalenceSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                double rows = 8.0 * circuits.size();
+                if (!first) cout << "," << endl;
+                first = false;
+                cout << "  {\"inputs\": " << inputs
+                     << ", \"depth\": " << depth
+                     << ", \"and_percent\": " << andPercent
+                     << ", \"circuits\": " << circuits.size()
+                     << ", \"average_length\": " << (double)length / circuits.size()
+                     << ", \"string_rows_per_s\": " << rows / stringSeconds
+                     << ", \"compiled_rows_per_s\": " << rows / compiledSeconds
+                     << ", \"cached_rows_per_s\": " << rows / cachedSeconds
+                     << ", \"compile_us\": " << compileSeconds * 1e6 / circuits.size()
+                     << ", \"equivalence_us\": " << equivalenceSeconds * 1e6 / (circuits.size() - 1)
+                     << ", \"equivalent_pairs\": " << equivalent
+                     << ", \"malformed\": " << malformed << "}";
+            }
+        }
+    }
+    cout << endl << "]" << endl;
+
+    cerr << mismatches << " mismatches\n";
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Answer queries line by line until "quit", compiled circuits stay cached between queries
+//   table <expr>            -> outputs of the 8 truthTable rows, e.g. 00010011
+//   equiv <expr> = <expr>   -> true | false
+void serve() {
+    string line;
+
+    while (getline(cin, line) && line != "quit") {
+        if (line.compare(0, 6, "table ") == 0) {
+            int bits = truthTableBits(line.substr(6));
+            if (bits == -1) {
+                cout << "error malformed expression" << endl;
+                continue;
+            }
+            for (int i = 0; i < 8; ++i) {
+                cout << ((bits >> i) & 1);
+            }
+            cout << endl;
+        } else if (line.compare(0, 6, "equiv ") == 0 && line.find('=') != string::npos) {
+            size_t split = line.find('=');
+            int bits1 = truthTableBits(line.substr(6, split - 6));
+            int bits2 = truthTableBits(line.substr(split + 1));
+            if (bits1 == -1 || bits2 == -1) {
+                cout << "error malformed expression" << endl;
+                continue;
+            }
+            cout << (bits1 == bits2 ? "true" : "false") << endl;
+        } else if (!line.empty()) {
+            cout << "error unknown request" << endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        return benchmark();
+    }
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        serve();
+        return 0;
+    }
+
     string originalExpr, simplifiedExpr;
 
     cout << "Enter the Original circuit expression (e.g. ((A|!C)&(B|!C)]&[(C|B)&(C|A)): ";
@@ -256,6 +564,10 @@ int main() {
     cout << "Enter the Simplified circuit expression (e.g. A&B): ";
     getline(cin, simplifiedExpr);
 
+    if (truthTableBits(originalExpr) == -1 || truthTableBits(simplifiedExpr) == -1) {
+        cout << "Invalid circuit expression, operators are missing operands or brackets don't match.\n";
+        return 1;
+    }
 
     if (checkSatisfiability(originalExpr, simplifiedExpr)) {
         cout << "Expressions are satisfiable.\n";
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <chrono>
 
 using namespace std;
 
@@ -31,7 +32,61 @@ string encryptMessage(const string &message, int a, int b, const string &alphabe
     return final;
 }
 
-int main() {
+//time encryptMessage for growing messages and print the results as JSON
+void benchmark() {
+    string alphabets[2] = {" AEIOUFGLMNPSTVHKR", " ABCDEFGHIJKLMNOPQRSTUVWXYZ"};
+    string names[2] = {"samoan", "latin"};
+    bool first = true;
+
+    cout << "[" << endl;
+    for (int k = 0; k < 2; k++) {
+        for (size_t size = 1024; size <= (64u << 20); size *= 8) {
+            string message(size, ' ');
+            for (size_t i = 0; i < size; i++) { //mostly alphabet characters, some that are not in it
+                message[i] = (i % 7 == 6) ? '.' : alphabets[k][i % alphabets[k].length()];
+            }
+
+            auto start = chrono::steady_clock::now();
+            string final = encryptMessage(message, 11, 17, alphabets[k]);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            if (!first) cout << "," << endl;
+            first = false;
+            cout << "  {\"function\": \"encryptMessage\", \"alphabet\": \"" << names[k]
+                 << "\", \"alphabet_size\": " << alphabets[k].length()
+                 << ", \"bytes\": " << size
+                 << ", \"seconds\": " << seconds
+                 << ", \"mb_per_s\": " << size / seconds / 1e6
+                 << ", \"ns_per_byte\": " << seconds * 1e9 / size
+                 << ", \"checksum\": " << (int)(unsigned char)final[size / 2] << "}";
+        }
+
+        //single characters, every symbol of the alphabet plus one that is not in it
+        int calls = 1000000, sum = 0;
+        int length = alphabets[k].length();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            char ch = (i % (length + 1) == length) ? '.' : alphabets[k][i % (length + 1)];
+            sum += encryptChar(ch, 11, 17, alphabets[k]);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "," << endl;
+        cout << "  {\"function\": \"encryptChar\", \"alphabet\": \"" << names[k]
+             << "\", \"alphabet_size\": " << length
+             << ", \"calls\": " << calls
+             << ", \"ns_per_call\": " << seconds * 1e9 / calls
+             << ", \"checksum\": " << sum << "}";
+    }
+    cout << endl << "]" << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        benchmark();
+        return 0;
+    }
+
     //samoan alphabet --> length : 18 (17 characters + space ( index 0 ) )
 
     string alphabet = " AEIOUFGLMNPSTVHKR"; // changing alphabet to be generic and fit different cases
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <chrono>
 
 using namespace std;
 
@@ -51,7 +52,68 @@ string affineDecrypt(string cipherText, int a, int b, int m,string alphabet) {
     return decryptedText;
 }
 
-int main() {
+// Time affineDecrypt, search and modInverse and print the results as JSON
+void benchmark() {
+    string alphabets[2] = {" AEIOUFGLMNPSTVHKR", " ABCDEFGHIJKLMNOPQRSTUVWXYZ"};
+    string names[2] = {"samoan", "latin"};
+    int keys[2] = {11, 5}; // coprime with 18 and 27
+
+    cout << "[" << endl;
+    for (int k = 0; k < 2; k++) {
+        int m = alphabets[k].size();
+
+        for (size_t size = 1024; size <= (32u << 20); size *= 8) {
+            string cipherText(size, ' ');
+            for (size_t i = 0; i < size; i++) {
+                cipherText[i] = alphabets[k][(i * 7) % m];
+            }
+
+            auto start = chrono::steady_clock::now();
+            string decryptedText = affineDecrypt(cipherText, keys[k], 17, m, alphabets[k]);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            cout << "  {\"function\": \"affineDecrypt\", \"alphabet\": \"" << names[k]
+                 << "\", \"alphabet_size\": " << m
+                 << ", \"bytes\": " << size
+                 << ", \"seconds\": " << seconds
+                 << ", \"mb_per_s\": " << size / seconds / 1e6
+                 << ", \"ns_per_byte\": " << seconds * 1e9 / size
+                 << ", \"checksum\": " << (int)(unsigned char)decryptedText[size / 2] << "}," << endl;
+        }
+
+        int calls = 1000000, sum = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            sum += search(alphabets[k], alphabets[k][i % m]);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  {\"function\": \"search\", \"alphabet\": \"" << names[k]
+             << "\", \"alphabet_size\": " << m
+             << ", \"calls\": " << calls
+             << ", \"ns_per_call\": " << seconds * 1e9 / calls
+             << ", \"checksum\": " << sum << "}," << endl;
+
+        sum = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < calls; i++) {
+            sum += modInverse(i % m, m);
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "  {\"function\": \"modInverse\", \"alphabet\": \"" << names[k]
+             << "\", \"alphabet_size\": " << m
+             << ", \"calls\": " << calls
+             << ", \"ns_per_call\": " << seconds * 1e9 / calls
+             << ", \"checksum\": " << sum << "}" << (k == 0 ? "," : "") << endl;
+    }
+    cout << "]" << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        benchmark();
+        return 0;
+    }
+
     string cipherText,alphabet;
     int a, b;
     cout << "Enter the affine ciphered message: ";